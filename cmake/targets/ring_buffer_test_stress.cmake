@@ -0,0 +1,24 @@
+#=============================
+# Stress test
+#=============================
+if(RING_BUFFER_STRESS_TESTS)
+    add_executable(ring_buffer_test_stress
+            test_mt/tring_buffer_stress.cpp)
+
+    target_include_directories(ring_buffer_test_stress PRIVATE ${RBUFF_HEADERS})
+    target_link_libraries(ring_buffer_test_stress PRIVATE gtest ${RBUFF_LIB})
+    # must match the flavour the library is compiled with (struct layout)
+    if (${CMAKE_RING_BUFFER_THREAD_SAFE})
+        target_compile_definitions(ring_buffer_test_stress PRIVATE RING_BUFFER_THREAD_SAFE=${CMAKE_RING_BUFFER_THREAD_SAFE})
+    endif()
+    target_compile_options(ring_buffer_test_stress PRIVATE -fsanitize=thread)
+    target_link_options(ring_buffer_test_stress PRIVATE -fsanitize=thread)
+    # sanitizer
+    target_use_mem_sanitizer(ring_buffer_test_stress ${RBUFF_TESTMT_CMEM_SANITIZER})
+
+    add_test(NAME test_ring_buffer_stress COMMAND ring_buffer_test_stress)
+    # Enable XML report (ops_per_sec recorded as test property)
+    include(GoogleTest)
+    gtest_discover_tests(ring_buffer_test_stress XML_OUTPUT_DIR "${CMAKE_BINARY_DIR}/test_output/")
+    enable_testing()
+endif()
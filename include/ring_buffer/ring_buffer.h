@@ -6,6 +6,9 @@
 #ifdef RING_BUFFER_THREAD_SAFE
 #include <pthread.h>
 #endif //RING_BUFFER_THREAD_SAFE
+#ifdef RING_BUFFER_LATENCY_TRACE
+#include <stdio.h>
+#endif //RING_BUFFER_LATENCY_TRACE
 
 // Architecture addressing:
 // if none supported -> dont compile
@@ -17,6 +20,45 @@ typedef uint32_t addr_t;
 #error "Unsupported pointer size"
 #endif
 
+#ifdef RING_BUFFER_LATENCY_TRACE
+// histogram precision: 2^SUB_BITS linear sub-buckets per power of 2 (max relative error 1/2^SUB_BITS)
+#define RING_BUFFER_TRACE_SUB_BITS 3
+#define RING_BUFFER_TRACE_BUCKETS ((64 - RING_BUFFER_TRACE_SUB_BITS + 1) << RING_BUFFER_TRACE_SUB_BITS)
+
+/**
+ * enqueue stamp of a single write:
+ * end: value of the written bytes counter after the write
+ * ts: CLOCK_MONOTONIC time of the write in ns
+ */
+struct RingBufferStamp {
+	uint64_t end;
+	uint64_t ts;
+};
+
+/**
+ * Latency trace: stamps each write and records the enqueue-to-dequeue delay (ns) of a write
+ * when its last byte is read into a log-linear (HDR-style) histogram.
+ * stamps: side array (FIFO) of pending write stamps, injected by caller
+ * stamps_size: capacity of stamps, writes are not stamped (dropped) while full
+ * head, tail: free running FIFO positions in stamps (64 bit: never wrap, stamps_size need not be a power of 2)
+ * written, read: total bytes written/read since attach
+ * dropped: number of writes not stamped
+ * max_ns: max recorded delay
+ * buckets: histogram counters, updated atomically (can be queried while in use)
+ */
+struct RingBufferTrace {
+	struct RingBufferStamp *stamps;
+	uint32_t stamps_size;
+	uint64_t head;
+	uint64_t tail;
+	uint64_t written;
+	uint64_t read;
+	uint64_t dropped;
+	uint64_t max_ns;
+	uint64_t buckets[RING_BUFFER_TRACE_BUCKETS];
+};
+#endif //RING_BUFFER_LATENCY_TRACE
+
 /**
  * Ring buffer structure:
  * cwrite_i: ptr to write index (0, size -1) which MSb is used as cycle flag (changes when wrapping).
@@ -25,6 +67,7 @@ typedef uint32_t addr_t;
  * Indicates the next byte to be read.
  * buffer: ptr to actual buffer used to store data in ring buffer
  * buffer_size: size of buffer in bytes
+ * trace: ptr to latency trace (RING_BUFFER_LATENCY_TRACE only), NULL if not traced
  */
 struct RingBuffer {
 	// ptr to cycle write index
@@ -38,6 +81,9 @@ struct RingBuffer {
 #ifdef RING_BUFFER_THREAD_SAFE
 	pthread_mutex_t mutex;
 #endif //RING_BUFFER_THREAD_SAFE
+#ifdef RING_BUFFER_LATENCY_TRACE
+	struct RingBufferTrace *trace;
+#endif //RING_BUFFER_LATENCY_TRACE
 } __attribute__((aligned(sizeof(addr_t))));
 
 
@@ -101,5 +147,59 @@ int32_t ring_buffer_write(struct RingBuffer *ring_buffer, uint8_t *data, uint32_
  */
 int32_t ring_buffer_read(struct RingBuffer *ring_buffer, uint8_t *data, uint32_t size);
 
+/**
+ * callback used by ring_buffer_consume to process a contiguous span of readable bytes
+ * @param span ptr to the first readable byte of the span (inside ring_buffer.buffer)
+ * @param size number of readable bytes in the span
+ * @param ctx user context forwarded from ring_buffer_consume
+ * note: span is valid only for the duration of the call and must not call back into the ring buffer
+ */
+typedef void (*RingBufferConsumer)(const uint8_t *span, uint32_t size, void *ctx);
+
+/**
+ * drain all readable bytes from ring_buffer.buffer without an intermediate copy.
+ * cwrite_i is loaded once, consumer is invoked for every readable span (at most 2, when wrapped)
+ * and cread_i is advanced once at the end.
+ * @param ring_buffer object to read data from
+ * @param consumer callback invoked for each contiguous readable span
+ * @param ctx user context forwarded to consumer
+ * @param budget max number of bytes to consume (fairness cap), 0 for unlimited
+ * @return number of bytes consumed, -1 otherwise
+ */
+int32_t ring_buffer_consume(struct RingBuffer *ring_buffer, RingBufferConsumer consumer, void *ctx, uint32_t budget);
+
+#ifdef RING_BUFFER_LATENCY_TRACE
+/**
+ * attach a latency trace to ring_buffer, resetting trace. Bytes already in ring_buffer are not traced.
+ * @param ring_buffer object to trace
+ * @param trace trace to attach (not owned by ring buffer)
+ * @param stamps side array used to store pending write stamps (not owned by ring buffer)
+ * @param stamps_size number of elements of stamps, should be >= max number of pending writes
+ * @return 0 if success, -1 otherwise
+ */
+int32_t ring_buffer_trace_attach(struct RingBuffer *ring_buffer, struct RingBufferTrace *trace,
+                                 struct RingBufferStamp *stamps, uint32_t stamps_size);
+
+/**
+ * @param trace trace to query
+ * @return number of recorded delays
+ */
+uint64_t ring_buffer_trace_count(const struct RingBufferTrace *trace);
+
+/**
+ * @param trace trace to query
+ * @param percentile percentile to query in range [0, 100]
+ * @return upper bound (ns) of the histogram bucket containing percentile, 0 if empty
+ */
+uint64_t ring_buffer_trace_percentile(const struct RingBufferTrace *trace, double percentile);
+
+/**
+ * dump non-empty histogram buckets as csv lines "low_ns,high_ns,count"
+ * @param trace trace to dump
+ * @param out stream to write to
+ */
+void ring_buffer_trace_dump(const struct RingBufferTrace *trace, FILE *out);
+#endif //RING_BUFFER_LATENCY_TRACE
+
 
 #endif //RING_BUFFER_H
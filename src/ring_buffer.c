@@ -2,6 +2,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stddef.h>
+#ifdef RING_BUFFER_LATENCY_TRACE
+#include <time.h>
+#endif //RING_BUFFER_LATENCY_TRACE
 //#include <stdio.h>
 // externs
 const uint32_t WORD_SIZE = __SIZEOF_POINTER__;
@@ -17,8 +20,12 @@ const struct RingBuffer RING_BUFFER_INVALID = {
 	0U,
 #ifdef RING_BUFFER_THREAD_SAFE
 	.
-	mutex = 0U
+	mutex = 0U,
 #endif //RING_BUFFER_THREAD_SAFE
+#ifdef RING_BUFFER_LATENCY_TRACE
+	.
+	trace = NULL
+#endif //RING_BUFFER_LATENCY_TRACE
 };
 // consts
 static const uint32_t LIN_BUFFER_OFFSET = WORD_SIZE * 2;
@@ -42,6 +49,14 @@ static uint8_t cycle__(addr_t addr)
 	return (addr & CYCLE_MASK) ? 1 : 0;
 }
 
+// number of bytes written but not yet read
+static addr_t used__(const addr_t buffer_size, const addr_t cr_addr, const addr_t cw_addr)
+{
+	if (cycle__(cr_addr) == cycle__(cw_addr))
+		return index__(cw_addr) - index__(cr_addr);
+	return buffer_size - index__(cr_addr) + index__(cw_addr);
+}
+
 // public interface
 struct RingBuffer ring_buffer_make_scattered(addr_t *cwrite_i, addr_t *cread_i, addr_t *base_addr, uint32_t size)
 {
@@ -90,52 +105,120 @@ void ring_buffer_reset(struct RingBuffer *ring_buffer)
 	ring_buffer->cwrite_i = NULL;
 	ring_buffer->cread_i = NULL;
 	ring_buffer->buffer = NULL;
+#ifdef RING_BUFFER_LATENCY_TRACE
+	ring_buffer->trace = NULL;
+#endif
 #ifdef RING_BUFFER_THREAD_SAFE
 	pthread_mutex_unlock(&ring_buffer->mutex);
 #endif
 }
 
+#ifdef RING_BUFFER_LATENCY_TRACE
+static uint64_t now_ns__(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// log-linear bucket: values < 2^SUB_BITS are exact, then 2^SUB_BITS sub-buckets per power of 2
+static uint32_t trace_bucket__(uint64_t value)
+{
+	const uint64_t sub_count = 1ULL << RING_BUFFER_TRACE_SUB_BITS;
+	if (value < sub_count)
+		return (uint32_t)value;
+	const uint32_t shift = 63 - __builtin_clzll(value) - RING_BUFFER_TRACE_SUB_BITS;
+	return ((shift + 1) << RING_BUFFER_TRACE_SUB_BITS) + (uint32_t)((value >> shift) & (sub_count - 1));
+}
+
+static uint64_t trace_bucket_low__(uint32_t bucket)
+{
+	const uint32_t sub_count = 1U << RING_BUFFER_TRACE_SUB_BITS;
+	if (bucket < sub_count)
+		return bucket;
+	const uint32_t shift = (bucket >> RING_BUFFER_TRACE_SUB_BITS) - 1;
+	return (uint64_t)(sub_count + (bucket & (sub_count - 1))) << shift;
+}
+
+static uint64_t trace_bucket_high__(uint32_t bucket)
+{
+	const uint32_t sub_count = 1U << RING_BUFFER_TRACE_SUB_BITS;
+	if (bucket < sub_count)
+		return bucket;
+	const uint32_t shift = (bucket >> RING_BUFFER_TRACE_SUB_BITS) - 1;
+	return trace_bucket_low__(bucket) + ((1ULL << shift) - 1);
+}
+
+// stamp a write of size bytes (called w/ ring buffer locked)
+static void trace_enqueue__(struct RingBufferTrace *trace, int32_t size)
+{
+	if (trace == NULL || size <= 0)
+		return;
+	trace->written += size;
+	if (trace->tail - trace->head == trace->stamps_size) {
+		++trace->dropped;// no room for stamp
+		return;
+	}
+	struct RingBufferStamp *stamp = &trace->stamps[trace->tail % trace->stamps_size];
+	stamp->end = trace->written;
+	stamp->ts = now_ns__();
+	++trace->tail;
+}
+
+// record delay of every write fully dequeued by a read of size bytes (called w/ ring buffer locked)
+static void trace_dequeue__(struct RingBufferTrace *trace, int32_t size)
+{
+	if (trace == NULL || size <= 0)
+		return;
+	trace->read += size;
+	if (trace->head == trace->tail || trace->stamps[trace->head % trace->stamps_size].end > trace->read)
+		return;
+	const uint64_t now = now_ns__();
+	while (trace->head != trace->tail) {
+		const struct RingBufferStamp *stamp = &trace->stamps[trace->head % trace->stamps_size];
+		if (stamp->end > trace->read)
+			break;
+		const uint64_t delay = now - stamp->ts;
+		__atomic_fetch_add(&trace->buckets[trace_bucket__(delay)], 1, __ATOMIC_RELAXED);
+		if (delay > __atomic_load_n(&trace->max_ns, __ATOMIC_RELAXED))
+			__atomic_store_n(&trace->max_ns, delay, __ATOMIC_RELAXED);
+		++trace->head;
+	}
+}
+#endif //RING_BUFFER_LATENCY_TRACE
+
 typedef void (*Copy)(addr_t *x_addr, uint8_t *data, uint32_t size);
 typedef void (*CopyWrapped)(addr_t *buffer, addr_t *x_addr, uint8_t *data, const addr_t first_chunk, addr_t cend_i);
 
 static
-int32_t transfer__(addr_t *buffer, const addr_t buffer_size, addr_t *cx_index, addr_t *cy_index, uint8_t *data,
+int32_t transfer__(addr_t *buffer, const addr_t buffer_size, addr_t *cx_index, const addr_t available, uint8_t *data,
 	uint32_t size, Copy cp_cback, CopyWrapped cp_wrp_cback)
 {
-	// y info: the index which handles the other transfer op type
-	const addr_t cy_addr = *(cy_index);
-	const uint8_t ycycle = cycle__(cy_addr);
-	const addr_t yi = index__(cy_addr);
 	// x info: the index which handles the requested transfer type
 	const addr_t cx_addr = *(cx_index);
 	uint8_t xcycle = cycle__(cx_addr);
 	const addr_t xi = index__(cx_addr);
 
-	if (size > buffer_size)
-		size = buffer_size;// transfer at most buffer_size
+	if (size > available)
+		size = available;// capped by the other index (y)
 
 	const addr_t unwrapped_xsize = xi + size;
 	addr_t x_addr = (addr_t)buffer + xi;
 
-	addr_t cend_i = unwrapped_xsize % buffer_size;
-	if (cend_i >= 0 && cend_i != unwrapped_xsize) {// wrapped/cycled
-		if (xcycle == ycycle && cend_i > yi) {
-			cend_i = yi;// capped by y index
-		}
+	if (unwrapped_xsize >= buffer_size) {// wrapped/cycled
 		const addr_t first_chunk = buffer_size - xi;
+		const addr_t cend_i = unwrapped_xsize - buffer_size;
 		// DEBUG STRING
-		// printf("\ns:%u,x:%p,b:%p,f:%u,xi:%u,yi:%u\n", buffer_size, (void *)x_addr, (void *)buffer, first_chunk, xi, yi);
+		// printf("\ns:%u,x:%p,b:%p,f:%u,xi:%u\n", buffer_size, (void *)x_addr, (void *)buffer, first_chunk, xi);
 		cp_wrp_cback(buffer, (addr_t *)x_addr, data, first_chunk, cend_i);
 		// update cycle x index
-		*(cx_index) = cend_i % buffer_size;
+		*(cx_index) = cend_i;
 		*(cx_index) |= (((addr_t)(!xcycle) << INDEX_SIZE) & CYCLE_MASK);
-		return first_chunk + cend_i;
+		return size;
 	}
-	if (xi < yi && xi + size > yi)
-		size = yi;// capped by y index
 	cp_cback((addr_t *)x_addr, data, size);
 	// update cycle x index
-	*(cx_index) = (xi + size) % buffer_size;
+	*(cx_index) = unwrapped_xsize;
 	*(cx_index) |= (((addr_t)xcycle << INDEX_SIZE) & CYCLE_MASK);
 	return size;
 }
@@ -159,7 +242,7 @@ int32_t ring_buffer_write(struct RingBuffer *ring_buffer, uint8_t *data, uint32_
 	// read info
 	const addr_t cr_addr = *(ring_buffer->cread_i);
 	const uint8_t rcycle = cycle__(cr_addr);
-	const uint8_t ri = index__(cr_addr);
+	const addr_t ri = index__(cr_addr);
 	// write info
 	const addr_t cw_addr = *(ring_buffer->cwrite_i);
 	uint8_t wcycle = cycle__(cw_addr);
@@ -177,16 +260,17 @@ int32_t ring_buffer_write(struct RingBuffer *ring_buffer, uint8_t *data, uint32_
 #endif
 		return 0; // buffer is full
 	}
-#ifdef RING_BUFFER_THREAD_SAFE
-	const int32_t written = transfer__(ring_buffer->buffer, ring_buffer->buffer_size, ring_buffer->cwrite_i, ring_buffer->cread_i, data,
-		size, copy_write__, copy_write_wrapped__);
-	pthread_mutex_unlock(&ring_buffer->mutex);
-	return written;
-#else
+	const addr_t free_size = ring_buffer->buffer_size - used__(ring_buffer->buffer_size, cr_addr, cw_addr);
 	// x = write, y = read
-	return transfer__(ring_buffer->buffer, ring_buffer->buffer_size, ring_buffer->cwrite_i, ring_buffer->cread_i, data,
+	const int32_t written = transfer__(ring_buffer->buffer, ring_buffer->buffer_size, ring_buffer->cwrite_i, free_size, data,
 		size, copy_write__, copy_write_wrapped__);
+#ifdef RING_BUFFER_LATENCY_TRACE
+	trace_enqueue__(ring_buffer->trace, written);
 #endif
+#ifdef RING_BUFFER_THREAD_SAFE
+	pthread_mutex_unlock(&ring_buffer->mutex);
+#endif
+	return written;
 }
 
 static
@@ -208,13 +292,13 @@ int32_t ring_buffer_read(struct RingBuffer *ring_buffer, uint8_t *data, uint32_t
 	// read info
 	const addr_t cr_addr = *(ring_buffer->cread_i);
 	const uint8_t rcycle = cycle__(cr_addr);
-	const uint8_t ri = index__(cr_addr);
+	const addr_t ri = index__(cr_addr);
 	// write info
 	const addr_t cw_addr = *(ring_buffer->cwrite_i);
 	uint8_t wcycle = cycle__(cw_addr);
 	const addr_t wi = index__(cw_addr);
 
-	if (rcycle == wcycle && wi < ri) {
+	if ((rcycle == wcycle && wi < ri) || (rcycle != wcycle && wi > ri)) {
 #ifdef RING_BUFFER_THREAD_SAFE
 		pthread_mutex_unlock(&ring_buffer->mutex);
 #endif
@@ -226,14 +310,133 @@ int32_t ring_buffer_read(struct RingBuffer *ring_buffer, uint8_t *data, uint32_t
 #endif
 		return 0; // buffer is empty
 	}
-#ifdef RING_BUFFER_THREAD_SAFE
-	const int32_t read = transfer__(ring_buffer->buffer, ring_buffer->buffer_size, ring_buffer->cread_i, ring_buffer->cwrite_i, data,
+	const addr_t used_size = used__(ring_buffer->buffer_size, cr_addr, cw_addr);
+	// x = read, y = write
+	const int32_t read = transfer__(ring_buffer->buffer, ring_buffer->buffer_size, ring_buffer->cread_i, used_size, data,
 		size, copy_read__, copy_read_wrapped__);
+#ifdef RING_BUFFER_LATENCY_TRACE
+	trace_dequeue__(ring_buffer->trace, read);
+#endif
+#ifdef RING_BUFFER_THREAD_SAFE
 	pthread_mutex_unlock(&ring_buffer->mutex);
+#endif
 	return read;
-#else
-	// x = read, y = write
-	return transfer__(ring_buffer->buffer, ring_buffer->buffer_size, ring_buffer->cread_i, ring_buffer->cwrite_i, data,
-		size, copy_read__, copy_read_wrapped__);
+}
+
+int32_t ring_buffer_consume(struct RingBuffer *ring_buffer, RingBufferConsumer consumer, void *ctx, uint32_t budget)
+{
+	if (consumer == NULL)
+		return -1;
+#ifdef RING_BUFFER_THREAD_SAFE
+	pthread_mutex_lock(&ring_buffer->mutex);
+#endif
+	// read info
+	const addr_t cr_addr = *(ring_buffer->cread_i);
+	const uint8_t rcycle = cycle__(cr_addr);
+	const addr_t ri = index__(cr_addr);
+	// write info: single snapshot for the whole batch
+	const addr_t cw_addr = *(ring_buffer->cwrite_i);
+	const uint8_t wcycle = cycle__(cw_addr);
+	const addr_t wi = index__(cw_addr);
+
+	if ((rcycle == wcycle && wi < ri) || (rcycle != wcycle && wi > ri)) {
+#ifdef RING_BUFFER_THREAD_SAFE
+		pthread_mutex_unlock(&ring_buffer->mutex);
+#endif
+		return -1; // invalid buffer
+	}
+	addr_t available = used__(ring_buffer->buffer_size, cr_addr, cw_addr);
+	if (budget > 0 && available > budget)
+		available = budget;// consume at most budget
+	if (available == 0) {
+#ifdef RING_BUFFER_THREAD_SAFE
+		pthread_mutex_unlock(&ring_buffer->mutex);
 #endif
+		return 0; // buffer is empty
+	}
+	const uint8_t *buffer = (const uint8_t *)ring_buffer->buffer;
+	const addr_t first_chunk = ring_buffer->buffer_size - ri;
+	if (available > first_chunk) {// wrapped/cycled
+		consumer(&buffer[ri], first_chunk, ctx);
+		consumer(buffer, available - first_chunk, ctx);
+	} else {
+		consumer(&buffer[ri], available, ctx);
+	}
+	// update cycle read index once
+	addr_t cend_i = ri + available;
+	uint8_t cycle = rcycle;
+	if (cend_i >= ring_buffer->buffer_size) {
+		cend_i -= ring_buffer->buffer_size;
+		cycle = !rcycle;
+	}
+	*(ring_buffer->cread_i) = cend_i | (((addr_t)cycle << INDEX_SIZE) & CYCLE_MASK);
+#ifdef RING_BUFFER_LATENCY_TRACE
+	trace_dequeue__(ring_buffer->trace, available);
+#endif
+#ifdef RING_BUFFER_THREAD_SAFE
+	pthread_mutex_unlock(&ring_buffer->mutex);
+#endif
+	return available;
+}
+
+#ifdef RING_BUFFER_LATENCY_TRACE
+int32_t ring_buffer_trace_attach(struct RingBuffer *ring_buffer, struct RingBufferTrace *trace,
+                                 struct RingBufferStamp *stamps, uint32_t stamps_size)
+{
+	if (trace == NULL || stamps == NULL || stamps_size == 0)
+		return -1;
+#ifdef RING_BUFFER_THREAD_SAFE
+	pthread_mutex_lock(&ring_buffer->mutex);
+#endif
+	memset(trace, 0x00, sizeof(*trace));
+	trace->stamps = stamps;
+	trace->stamps_size = stamps_size;
+	// pending bytes have no stamp: count them as written so stamps of next writes line up
+	trace->written = used__(ring_buffer->buffer_size, *(ring_buffer->cread_i), *(ring_buffer->cwrite_i));
+	ring_buffer->trace = trace;
+#ifdef RING_BUFFER_THREAD_SAFE
+	pthread_mutex_unlock(&ring_buffer->mutex);
+#endif
+	return 0;
+}
+
+uint64_t ring_buffer_trace_count(const struct RingBufferTrace *trace)
+{
+	uint64_t count = 0;
+	for (uint32_t i = 0; i < RING_BUFFER_TRACE_BUCKETS; i++)
+		count += __atomic_load_n(&trace->buckets[i], __ATOMIC_RELAXED);
+	return count;
+}
+
+uint64_t ring_buffer_trace_percentile(const struct RingBufferTrace *trace, double percentile)
+{
+	const uint64_t count = ring_buffer_trace_count(trace);
+	if (count == 0)
+		return 0;
+	if (percentile < 0)
+		percentile = 0;
+	if (percentile > 100)
+		percentile = 100;
+	uint64_t target = (uint64_t)(percentile / 100.0 * count + 0.5);
+	if (target == 0)
+		target = 1;
+	uint64_t cumulative = 0;
+	for (uint32_t i = 0; i < RING_BUFFER_TRACE_BUCKETS; i++) {
+		cumulative += __atomic_load_n(&trace->buckets[i], __ATOMIC_RELAXED);
+		if (cumulative >= target)
+			return trace_bucket_high__(i);
+	}
+	// buckets updated while iterating
+	return __atomic_load_n(&trace->max_ns, __ATOMIC_RELAXED);
+}
+
+void ring_buffer_trace_dump(const struct RingBufferTrace *trace, FILE *out)
+{
+	for (uint32_t i = 0; i < RING_BUFFER_TRACE_BUCKETS; i++) {
+		const uint64_t count = __atomic_load_n(&trace->buckets[i], __ATOMIC_RELAXED);
+		if (count > 0)
+			fprintf(out, "%llu,%llu,%llu\n", (unsigned long long)trace_bucket_low__(i),
+				(unsigned long long)trace_bucket_high__(i), (unsigned long long)count);
+	}
 }
+#endif //RING_BUFFER_LATENCY_TRACE
@@ -178,6 +178,163 @@ void trbuf_write_read_wrap_many_times(void) {
   TEST_ASSERT_EQUAL_MEMORY(write_buf, read_buf, 3);
 }
 
+void trbuf_write_read_capped(void) {
+  uint8_t write_buf[rb.buffer_size];
+  uint8_t read_buf[rb.buffer_size];
+  for (int i = 0; i < rb.buffer_size; i++)
+    write_buf[i] = (uint8_t)i;
+  // move read index away from 0
+  int32_t result = ring_buffer_write(&rb, write_buf, 30);
+  TEST_ASSERT_EQUAL(result, 30);
+  result = ring_buffer_read(&rb, read_buf, 20);
+  TEST_ASSERT_EQUAL(result, 20);
+  // READ capped by pending bytes
+  result = ring_buffer_read(&rb, read_buf, rb.buffer_size);
+  TEST_ASSERT_EQUAL(result, 10);
+  TEST_ASSERT_EQUAL_MEMORY(&write_buf[20], read_buf, 10);
+  TEST_ASSERT_EQUAL(*rb.cread_i, *rb.cwrite_i);
+  // WRITE capped by free bytes (wrapping)
+  result = ring_buffer_write(&rb, write_buf, rb.buffer_size - 5);
+  TEST_ASSERT_EQUAL(result, rb.buffer_size - 5);
+  result = ring_buffer_write(&rb, write_buf, rb.buffer_size);
+  TEST_ASSERT_EQUAL(result, 5);
+  result = ring_buffer_read(&rb, read_buf, rb.buffer_size);
+  TEST_ASSERT_EQUAL(result, rb.buffer_size);
+  TEST_ASSERT_EQUAL_MEMORY(write_buf, read_buf, rb.buffer_size - 5);
+  TEST_ASSERT_EQUAL_MEMORY(write_buf, &read_buf[rb.buffer_size - 5], 5);
+}
+
+struct ConsumeCtx {
+  uint8_t data[128];
+  uint32_t size;
+  int spans;
+};
+
+static void _rbuf_consumer(const uint8_t *span, uint32_t size, void *ctx) {
+  struct ConsumeCtx *c = (struct ConsumeCtx *)ctx;
+  memcpy(&c->data[c->size], span, size);
+  c->size += size;
+  ++c->spans;
+}
+
+void trbuf_consume_notwrapped(void) {
+  struct ConsumeCtx ctx = {0};
+  char msg[] = "Hello World!";
+  const int msg_size = strlen(msg);
+  // EMPTY
+  int32_t result = ring_buffer_consume(&rb, _rbuf_consumer, &ctx, 0);
+  TEST_ASSERT_EQUAL(result, 0);
+  TEST_ASSERT_EQUAL(ctx.spans, 0);
+  // WRITE
+  result = ring_buffer_write(&rb, msg, msg_size);
+  TEST_ASSERT_EQUAL(result, msg_size);
+  // CONSUME
+  result = ring_buffer_consume(&rb, _rbuf_consumer, &ctx, 0);
+  TEST_ASSERT_EQUAL(result, msg_size);
+  TEST_ASSERT_EQUAL(ctx.spans, 1);
+  TEST_ASSERT_EQUAL_MEMORY(msg, ctx.data, msg_size);
+  TEST_ASSERT_EQUAL(*rb.cread_i, *rb.cwrite_i);
+}
+
+void trbuf_consume_wrapped(void) {
+  struct ConsumeCtx ctx = {0};
+  const int wrapped_size = rb.buffer_size/2 + 2;
+  uint8_t write_buf[wrapped_size];
+  uint8_t read_buf[rb.buffer_size];
+  // move indexes close to the end of buffer
+  memset(read_buf, 0x11, rb.buffer_size);
+  ring_buffer_write(&rb, read_buf, rb.buffer_size - 4);
+  ring_buffer_read(&rb, read_buf, rb.buffer_size - 4);
+  // WRITE
+  for (int i = 0; i < wrapped_size; i++)
+    write_buf[i] = (uint8_t)i;
+  int32_t result = ring_buffer_write(&rb, write_buf, wrapped_size);
+  TEST_ASSERT_EQUAL(result, wrapped_size);
+  // CONSUME
+  result = ring_buffer_consume(&rb, _rbuf_consumer, &ctx, 0);
+  TEST_ASSERT_EQUAL(result, wrapped_size);
+  TEST_ASSERT_EQUAL(ctx.spans, 2);
+  TEST_ASSERT_EQUAL_MEMORY(write_buf, ctx.data, wrapped_size);
+  TEST_ASSERT_EQUAL(*rb.cread_i, *rb.cwrite_i);
+  TEST_ASSERT_EQUAL(*rb.cread_i & CYCLE_MASK, CYCLE_MASK);
+}
+
+void trbuf_consume_budget(void) {
+  struct ConsumeCtx ctx = {0};
+  const int msg_size = rb.buffer_size;
+  uint8_t write_buf[msg_size];
+  for (int i = 0; i < msg_size; i++)
+    write_buf[i] = (uint8_t)i;
+  // WRITE (full buffer)
+  int32_t result = ring_buffer_write(&rb, write_buf, msg_size);
+  TEST_ASSERT_EQUAL(result, msg_size);
+  // CONSUME in budgeted batches
+  result = ring_buffer_consume(&rb, _rbuf_consumer, &ctx, 10);
+  TEST_ASSERT_EQUAL(result, 10);
+  result = ring_buffer_consume(&rb, _rbuf_consumer, &ctx, 0);
+  TEST_ASSERT_EQUAL(result, msg_size - 10);
+  TEST_ASSERT_EQUAL(ctx.spans, 2);
+  TEST_ASSERT_EQUAL_MEMORY(write_buf, ctx.data, msg_size);
+  result = ring_buffer_consume(&rb, _rbuf_consumer, &ctx, 0);
+  TEST_ASSERT_EQUAL(result, 0);
+}
+
+void trbuf_consume_fail(void) {
+  struct ConsumeCtx ctx = {0};
+  // BREAK RBUF
+  *(rb.cread_i) = *(rb.cwrite_i) + 1;
+  int32_t result = ring_buffer_consume(&rb, _rbuf_consumer, &ctx, 0);
+  TEST_ASSERT_EQUAL(result, -1);
+  TEST_ASSERT_EQUAL(ctx.spans, 0);
+  result = ring_buffer_consume(&rb, NULL, &ctx, 0);
+  TEST_ASSERT_EQUAL(result, -1);
+}
+
+#ifdef RING_BUFFER_LATENCY_TRACE
+void trbuf_trace(void) {
+  static struct RingBufferTrace trace;
+  struct RingBufferStamp stamps[2];
+  uint8_t buf[8] = {0};
+  TEST_ASSERT_EQUAL(ring_buffer_trace_attach(&rb, &trace, NULL, 2), -1);
+  TEST_ASSERT_EQUAL(ring_buffer_trace_attach(&rb, &trace, stamps, 2), 0);
+  TEST_ASSERT_EQUAL(ring_buffer_trace_percentile(&trace, 50), 0);
+  // 3 writes, 2 stamps: last one dropped
+  ring_buffer_write(&rb, buf, 4);
+  ring_buffer_write(&rb, buf, 4);
+  ring_buffer_write(&rb, buf, 4);
+  TEST_ASSERT_EQUAL(trace.dropped, 1);
+  // partial read of first write: not recorded
+  ring_buffer_read(&rb, buf, 2);
+  TEST_ASSERT_EQUAL(ring_buffer_trace_count(&trace), 0);
+  // first and second write dequeued
+  ring_buffer_read(&rb, buf, 6);
+  TEST_ASSERT_EQUAL(ring_buffer_trace_count(&trace), 2);
+  ring_buffer_read(&rb, buf, 4);
+  TEST_ASSERT_EQUAL(ring_buffer_trace_count(&trace), 2);
+  // stamp slots reused
+  ring_buffer_write(&rb, buf, 4);
+  ring_buffer_consume(&rb, _rbuf_consumer, &(struct ConsumeCtx){0}, 0);
+  TEST_ASSERT_EQUAL(ring_buffer_trace_count(&trace), 3);
+  TEST_ASSERT_TRUE(ring_buffer_trace_percentile(&trace, 100) >= trace.max_ns);
+  TEST_ASSERT_TRUE(ring_buffer_trace_percentile(&trace, 0) <= ring_buffer_trace_percentile(&trace, 100));
+  // FIFO positions crossing 2^32 w/ stamps_size not a power of 2: every write recorded once
+  struct RingBufferStamp stamps3[3];
+  TEST_ASSERT_EQUAL(ring_buffer_trace_attach(&rb, &trace, stamps3, 3), 0);
+  trace.head = trace.tail = UINT32_MAX;
+  ring_buffer_write(&rb, buf, 4);
+  ring_buffer_write(&rb, buf, 4);
+  ring_buffer_write(&rb, buf, 4);
+  TEST_ASSERT_EQUAL(trace.dropped, 0);
+  for (int i = 1; i <= 3; i++) {
+    ring_buffer_read(&rb, buf, 2);
+    TEST_ASSERT_EQUAL(ring_buffer_trace_count(&trace), i - 1);
+    ring_buffer_read(&rb, buf, 2);
+    TEST_ASSERT_EQUAL(ring_buffer_trace_count(&trace), i);
+  }
+  TEST_ASSERT_EQUAL(trace.head, trace.tail);
+}
+#endif //RING_BUFFER_LATENCY_TRACE
+
 int main(void) {
   UNITY_BEGIN();
   RUN_TEST(trbuf_ctor_linear);
@@ -191,5 +348,13 @@ int main(void) {
   RUN_TEST(trbuf_write_read_wrapped);
   RUN_TEST(trbuf_write_read_perfect_wrap);
   RUN_TEST(trbuf_write_read_wrap_many_times);
+  RUN_TEST(trbuf_write_read_capped);
+  RUN_TEST(trbuf_consume_notwrapped);
+  RUN_TEST(trbuf_consume_wrapped);
+  RUN_TEST(trbuf_consume_budget);
+  RUN_TEST(trbuf_consume_fail);
+#ifdef RING_BUFFER_LATENCY_TRACE
+  RUN_TEST(trbuf_trace);
+#endif //RING_BUFFER_LATENCY_TRACE
   return UNITY_END();
 }
\ No newline at end of file
@@ -0,0 +1,261 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include "ring_buffer/ring_buffer.h"
+}
+
+/**
+ * Stress harness: producers push sequence-numbered records, consumers pop them and
+ * check per-producer FIFO order, no loss and no duplication. No sleeps, fixed seeds.
+ * Number of records per test can be overridden with env RBUFF_STRESS_OPS.
+ */
+struct Record {
+		uint32_t producer;
+		uint32_t seq;
+};
+
+static const uint32_t RECORD_SIZE = sizeof(Record);
+// ring capacity in records (buffer_size is a multiple of RECORD_SIZE so records never tear)
+static const uint32_t BUFFER_RECORDS = 64;
+// max records per read
+static const uint32_t BATCH_RECORDS = 16;
+
+static uint32_t stress_records()
+{
+		const char *env = getenv("RBUFF_STRESS_OPS");
+		return env ? (uint32_t)strtoul(env, NULL, 10) : (1U << 20);
+}
+
+/**
+ * per consumer view of the received stream
+ * next: expected (min) next seq of each producer, seen: seq already received
+ */
+struct Checker {
+		std::vector<uint32_t> next;
+		std::vector<std::vector<uint8_t>> seen;
+		uint32_t received = 0;
+
+		Checker(uint32_t producers, uint32_t records) : next(producers, 0), seen(producers, std::vector<uint8_t>(records, 0)) {}
+
+		void check(const uint8_t *data, uint32_t size)
+		{
+				EXPECT_EQ(size % RECORD_SIZE, 0U);
+				for (uint32_t off = 0; off + RECORD_SIZE <= size; off += RECORD_SIZE) {
+						Record r;
+						memcpy(&r, &data[off], RECORD_SIZE);
+						ASSERT_LT(r.producer, next.size());
+						ASSERT_LT(r.seq, seen[r.producer].size());
+						// FIFO per producer
+						EXPECT_GE(r.seq, next[r.producer]);
+						next[r.producer] = r.seq + 1;
+						++seen[r.producer][r.seq];
+						++received;
+				}
+		}
+};
+
+static void checker_consumer(const uint8_t *span, uint32_t size, void *ctx)
+{
+		static_cast<Checker *>(ctx)->check(span, size);
+}
+
+// merge consumer views: every seq of every producer received exactly once
+static void expect_exactly_once(const std::vector<Checker> &checkers, uint32_t producers, uint32_t records)
+{
+		uint32_t lost = 0, duplicated = 0;
+		for (uint32_t p = 0; p < producers; p++) {
+				for (uint32_t s = 0; s < records; s++) {
+						uint32_t count = 0;
+						for (const auto &c : checkers)
+								count += c.seen[p][s];
+						lost += (count == 0);
+						duplicated += (count > 1);
+				}
+		}
+		EXPECT_EQ(lost, 0U);
+		EXPECT_EQ(duplicated, 0U);
+}
+
+static void report(const char *name, uint64_t ops, std::chrono::steady_clock::duration elapsed)
+{
+		const double secs = std::chrono::duration<double>(elapsed).count();
+		const double ops_per_sec = secs > 0 ? ops / secs : 0;
+		printf("stress:%s:ops:%llu,elapsed_ms:%.1f,ops_per_sec:%.0f\n", name, (unsigned long long)ops, secs * 1000, ops_per_sec);
+		::testing::Test::RecordProperty("ops_per_sec", std::to_string((uint64_t)ops_per_sec));
+}
+
+class RingBufferStress : public ::testing::Test {
+protected:
+		void SetUp() override
+		{
+				const uint32_t mem_size = WORD_SIZE * 2 + BUFFER_RECORDS * RECORD_SIZE;
+				mem = (addr_t *)calloc(mem_size, 1);
+				ring_buffer = ring_buffer_make_linear(mem, mem_size);
+				ASSERT_EQ(ring_buffer.buffer_size, BUFFER_RECORDS * RECORD_SIZE);
+		}
+
+		void TearDown() override
+		{
+				ring_buffer_reset(&ring_buffer);
+				free(mem);
+		}
+
+		addr_t *mem = NULL;
+		struct RingBuffer ring_buffer;
+};
+
+#ifdef RING_BUFFER_THREAD_SAFE
+
+struct Topology {
+		uint32_t producers;
+		uint32_t consumers;
+		// consumers drain through ring_buffer_consume instead of ring_buffer_read
+		bool batch;
+};
+
+class RingBufferStressMT : public RingBufferStress, public ::testing::WithParamInterface<Topology> {};
+
+static void StressProducer(struct RingBuffer *ring_buffer, uint32_t id, uint32_t records, std::atomic<bool> *abort)
+{
+		for (uint32_t seq = 0; seq < records && !abort->load(); seq++) {
+				Record r = { id, seq };
+				int32_t written;
+				while ((written = ring_buffer_write(ring_buffer, (uint8_t *)&r, RECORD_SIZE)) == 0 && !abort->load())
+						std::this_thread::yield();// buffer is full
+				if (written != 0 && written != (int32_t)RECORD_SIZE) {
+						EXPECT_EQ(written, (int32_t)RECORD_SIZE);
+						abort->store(true);
+				}
+		}
+}
+
+static void StressConsumer(struct RingBuffer *ring_buffer, Checker *checker, bool batch, uint64_t total,
+	std::atomic<uint64_t> *consumed, std::atomic<bool> *abort)
+{
+		uint8_t data[BATCH_RECORDS * RECORD_SIZE];
+		while (consumed->load() < total && !abort->load()) {
+				const int32_t ret = batch ?
+					ring_buffer_consume(ring_buffer, checker_consumer, checker, sizeof(data)) :
+					ring_buffer_read(ring_buffer, data, sizeof(data));
+				if (ret < 0) {
+						EXPECT_GE(ret, 0);
+						abort->store(true);
+				} else if (ret == 0) {
+						std::this_thread::yield();// buffer is empty
+				} else {
+						if (!batch)
+								checker->check(data, ret);
+						consumed->fetch_add(ret / RECORD_SIZE);
+				}
+		}
+}
+
+TEST_P(RingBufferStressMT, FifoExactlyOnce)
+{
+		const Topology t = GetParam();
+		const uint32_t records = stress_records() / t.producers;
+		const uint64_t total = (uint64_t)records * t.producers;
+		std::atomic<uint64_t> consumed(0);
+		std::atomic<bool> abort(false);
+		std::vector<Checker> checkers(t.consumers, Checker(t.producers, records));
+		std::vector<std::thread> threads;
+
+		const auto start = std::chrono::steady_clock::now();
+		for (uint32_t c = 0; c < t.consumers; c++)
+				threads.emplace_back(StressConsumer, &ring_buffer, &checkers[c], t.batch, total, &consumed, &abort);
+		for (uint32_t p = 0; p < t.producers; p++)
+				threads.emplace_back(StressProducer, &ring_buffer, p, records, &abort);
+		for (auto &th : threads)
+				th.join();
+		const auto elapsed = std::chrono::steady_clock::now() - start;
+
+		ASSERT_FALSE(abort.load());
+		EXPECT_EQ(consumed.load(), total);
+		EXPECT_EQ(*ring_buffer.cread_i, *ring_buffer.cwrite_i);
+		expect_exactly_once(checkers, t.producers, records);
+		// ops: one write + one read per record
+		report(::testing::UnitTest::GetInstance()->current_test_info()->name(), total * 2, elapsed);
+}
+
+INSTANTIATE_TEST_SUITE_P(Topologies, RingBufferStressMT, ::testing::Values(
+	Topology{ 1, 1, false }, Topology{ 1, 4, false }, Topology{ 4, 1, false }, Topology{ 4, 4, false },
+	Topology{ 1, 1, true }, Topology{ 1, 4, true }, Topology{ 4, 1, true }, Topology{ 4, 4, true }),
+	[](const ::testing::TestParamInfo<Topology> &info) {
+		return "P" + std::to_string(info.param.producers) + "C" + std::to_string(info.param.consumers) +
+			(info.param.batch ? "Consume" : "Read");
+	});
+
+#else
+
+/**
+ * lock-free flavour is not safe for concurrent access:
+ * interleave producers and consumer deterministically (fixed seed) within a single thread.
+ */
+static void stress_interleaved(struct RingBuffer *ring_buffer, bool batch)
+{
+		const uint32_t producers = 4;
+		const uint32_t records = stress_records() / producers;
+		std::vector<Checker> checkers(1, Checker(producers, records));
+		std::vector<uint32_t> next_seq(producers, 0);
+		std::mt19937 gen(42);
+		std::uniform_int_distribution<uint32_t> pick(0, producers - 1);
+		std::uniform_int_distribution<uint32_t> burst(1, BUFFER_RECORDS);
+		uint8_t data[BUFFER_RECORDS * RECORD_SIZE];
+		uint64_t produced = 0, consumed = 0;
+		const uint64_t total = (uint64_t)records * producers;
+
+		const auto start = std::chrono::steady_clock::now();
+		while (consumed < total) {
+				// produce a burst of records from a random producer
+				const uint32_t p = pick(gen);
+				for (uint32_t n = burst(gen); n > 0 && next_seq[p] < records; n--) {
+						Record r = { p, next_seq[p] };
+						const int32_t written = ring_buffer_write(ring_buffer, (uint8_t *)&r, RECORD_SIZE);
+						if (written == 0)
+								break;// buffer is full
+						ASSERT_EQ(written, (int32_t)RECORD_SIZE);
+						++next_seq[p];
+						++produced;
+				}
+				// consume a burst of random size
+				const uint32_t size = burst(gen) * RECORD_SIZE;
+				const int32_t ret = batch ?
+					ring_buffer_consume(ring_buffer, checker_consumer, &checkers[0], size) :
+					ring_buffer_read(ring_buffer, data, size);
+				ASSERT_GE(ret, 0);
+				if (!batch)
+						checkers[0].check(data, ret);
+				consumed += ret / RECORD_SIZE;
+		}
+		const auto elapsed = std::chrono::steady_clock::now() - start;
+
+		EXPECT_EQ(produced, total);
+		EXPECT_EQ(consumed, total);
+		EXPECT_EQ(*ring_buffer->cread_i, *ring_buffer->cwrite_i);
+		expect_exactly_once(checkers, producers, records);
+		report(::testing::UnitTest::GetInstance()->current_test_info()->name(), total * 2, elapsed);
+}
+
+TEST_F(RingBufferStress, InterleavedRead)
+{
+		stress_interleaved(&ring_buffer, false);
+}
+
+TEST_F(RingBufferStress, InterleavedConsume)
+{
+		stress_interleaved(&ring_buffer, true);
+}
+
+#endif //RING_BUFFER_THREAD_SAFE
+// Main function for running tests
+int main(int argc, char **argv)
+{
+		::testing::InitGoogleTest(&argc, argv);
+		return RUN_ALL_TESTS();
+}